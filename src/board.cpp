@@ -22,6 +22,7 @@ uint8_t ListGCD(const std::vector<Tile>& nums) {
 
 Board::Board(const std::vector<Tile>& p) {
 	occ = 0ULL;
+	remaining = p.size() < 64 ? (1ULL << p.size()) - 1 : ~0ULL;
 	piece_index = 0;
 	current_imbalance = 0;
 	pieces = p;
@@ -51,16 +52,53 @@ Board::Board(const std::vector<Tile>& p) {
 	}
 
 	suffix_max_imbalance[pieces.size()] = 0;
+
+	// With every piece unplaced, the unordered bound is the whole suffix
+	// (the imbalance of a piece only flips sign when it moves, so placePiece/popPiece keep this up to date)
+	remaining_max_imbalance = suffix_max_imbalance[0];
+
 	tile_gcd = ListGCD(pieces); // Precompute the GCD for the board
 }
 
+CellTables::CellTables(const std::vector<Tile>& pieces) {
+	// Group identical pieces so they can be placed in a fixed order
+	std::vector<size_t> group_first;
+	for (size_t i = 0; i < pieces.size(); ++i) {
+		size_t g = 0;
+		while (g < group_first.size() && !(pieces[group_first[g]] == pieces[i]))
+			++g;
+		if (g == group_first.size()) {
+			group_first.push_back(i);
+			group_masks.push_back(0ULL);
+		}
+		group_masks[g] |= 1ULL << i;
+	}
+
+	// Precompute, for every cell, the placements of each group whose lowest square covers it
+	for (uint8_t cell = 0; cell < 64; ++cell) {
+		anchored_start[cell] = anchored.size();
+		for (size_t g = 0; g < group_first.size(); ++g) {
+			const Tile& t = pieces[group_first[g]];
+			const uint8_t lowest = LSB(t.repr);
+			if (cell < lowest)
+				continue;
+
+			const uint8_t pos = cell - lowest;
+			if ((pos % 8) > 7 - t.p_width || (pos / 8) > 7 - t.p_height)
+				continue;
+
+			anchored.push_back({ t.repr << pos, pos, static_cast<uint8_t>(g) });
+		}
+	}
+	anchored_start[64] = anchored.size();
+}
+
 // Bitwise floodcount validation
-bool Board::hasSolvableRegions() const {
+bool Board::hasSolvableRegions(const int8_t min_sz) const {
 	uint64_t empty = ~occ;
 	if (!empty)
 		return true;
 
-	const int8_t min_sz = suffix_min_size[piece_index];
 	if (!min_sz)
 		return true;
 
@@ -123,8 +161,8 @@ char Board::getChar(const uint8_t x, const uint8_t y) const {
 
 	// Reconstruct which piece is here
 	for (size_t i = 0; i < piece_index; ++i)
-		if ((pieces[i].repr << history[i].pos) & mask)
-			return 'a' + (i % 26);
+		if ((pieces[history[i].piece].repr << history[i].pos) & mask)
+			return 'a' + (history[i].piece % 26);
 
 	return '?';
 }
@@ -3,6 +3,7 @@
 
 #include "push_pop_history_array.h"
 #include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -42,8 +43,32 @@ struct Tile {
 	bool operator==(const Tile& other) const { return repr == other.repr; }
 };
 
+// A placement of an identical-piece group whose lowest square lands on a given cell
+struct AnchoredPlacement {
+	uint64_t mask;
+	uint8_t pos;
+	uint8_t group;
+};
+
+// Per-cell placement tables for the cell-first engine. They only depend on the tile set,
+// so they are built once per tile set instead of living in (and being copied with) every Board.
+class CellTables {
+	std::vector<uint64_t> group_masks;		 // Piece indices of each group of identical pieces
+	std::vector<AnchoredPlacement> anchored; // Placements covering each cell, grouped by cell
+	uint16_t anchored_start[65];
+
+public:
+	CellTables() = default;
+	CellTables(const std::vector<Tile>& pieces); // Same piece order as the Board it is used with
+
+	inline uint64_t getGroupMask(const uint8_t group) const { return group_masks[group]; }
+	inline const AnchoredPlacement* begin(const uint8_t cell) const { return anchored.data() + anchored_start[cell]; }
+	inline const AnchoredPlacement* end(const uint8_t cell) const { return anchored.data() + anchored_start[cell + 1]; }
+};
+
 class Board {
 	uint64_t occ;
+	uint64_t remaining; // Bit i is set while piece i is unplaced (only kept up to date by placePiece/popPiece)
 	PushPopHistoryArray history;
 	std::vector<Tile> pieces;
 	std::vector<uint8_t> suffix_min_size;
@@ -51,6 +76,9 @@ class Board {
 	size_t piece_index;
 	uint8_t tile_gcd;
 	int current_imbalance;
+	int remaining_max_imbalance; // Parity bound over the unplaced pieces, for placePiece/popPiece
+
+	bool hasSolvableRegions(const int8_t min_sz) const;
 
 public:
 	Board() = default;
@@ -67,7 +95,9 @@ public:
 	inline uint8_t openSquares() const { return BIT_COUNT(~occ); }
 	inline size_t numPieces() const { return pieces.size(); }
 	inline bool done() const { return piece_index == pieces.size(); }
+	inline uint64_t getRemaining() const { return remaining; }
 	inline int getSuffixMaxImbalance() const { return suffix_max_imbalance[piece_index]; }
+	inline int getRemainingMaxImbalance() const { return remaining_max_imbalance; }
 	inline int getCurrentImbalance() const { return current_imbalance; }
 	inline bool symmetryBroken() const  { return occ & FIRST_QUAD; }
 
@@ -80,7 +110,7 @@ public:
 		const uint8_t white = BIT_COUNT(p & ~CHECKERBOARD_MASK);
 		const int8_t delta = static_cast<int8_t>(black - white);
 
-		history.emplace(occ, pos, delta); // Store current occ and new position
+		history.emplace(occ, pos, delta, piece_index); // Store current occ and new position
 		occ |= p;
 		current_imbalance += delta;
 		++piece_index;
@@ -97,8 +127,32 @@ public:
 		--piece_index;
 	}
 
-	// Floodfill verification
-	bool hasSolvableRegions() const;
+	// Place or remove any piece, for searches that do not follow the piece order.
+	// These also track the unplaced pieces, so don't mix them with place/pop on the same board.
+	inline void placePiece(const size_t index, const uint8_t pos) {
+		const uint64_t p = pieces[index].repr << pos;
+		const int8_t delta = static_cast<int8_t>(BIT_COUNT(p & CHECKERBOARD_MASK) - BIT_COUNT(p & ~CHECKERBOARD_MASK));
+
+		history.emplace(occ, pos, delta, index);
+		occ |= p;
+		remaining &= ~(1ULL << index);
+		current_imbalance += delta;
+		remaining_max_imbalance -= std::abs(delta);
+		++piece_index;
+	}
+
+	inline void popPiece() {
+		if (history.empty())
+			return;
+
+		remaining |= 1ULL << history.back().piece;
+		remaining_max_imbalance += std::abs(history.back().balance_delta);
+		pop();
+	}
+
+	// Floodfill verification, for the next piece in order or for any unplaced piece
+	inline bool hasSolvableRegions() const { return hasSolvableRegions(suffix_min_size[piece_index]); }
+	inline bool hasSolvableRegionsAnyOrder() const { return hasSolvableRegions(remaining ? suffix_min_size[LSB(remaining)] : 0); }
 
 	// Operator overloads
 	bool operator==(const Board& other) const { return occ != other.occ; }
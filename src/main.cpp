@@ -1,20 +1,26 @@
+#include "perf_counters.h"
 #include "solver.h"
 #include <atomic>
 #include <fstream>
+#include <mutex>
+#include <random>
 #include <thread>
 
 #ifndef NOMULTIT
 #include "ThreadedPriorityQueue/src/threaded_priority_queue.h"
 #endif
 
-#define TASK_QUEUE_SIZE 4096
+#define TASK_QUEUE_SIZE		   4096
+#define PORTFOLIO_FIRST_BUDGET (1ULL << 14)
 
 // Global synchronization
 std::atomic<size_t> solution_count{ 0 };
 std::atomic<bool> finished{ false };
 
-// Shared task queue and silent status
+// Shared task queue, silent status and search engine
 bool silent = false;
+bool cell_first = false;
+CellTables cell_tables; // Only built for the cell-first engine
 
 #ifndef NOMULTIT
 // Threaded priority queue for tasks
@@ -35,7 +41,8 @@ void workerThread(const bool one_solution) {
 		// Make a local copy to work on
 		Board board = task_queue.pop(); // Get the top element of the priority queue and pop it.
 		size_t internal_count = 0;
-		bool result = solve(board, internal_count, one_solution, silent);
+		PerfScope scope(PHASE_SOLVE);
+		bool result = cell_first ? solveCellFirst(board, cell_tables, internal_count, one_solution, silent) : solve(board, internal_count, one_solution, silent);
 
 		local_sol_count += internal_count;
 
@@ -55,8 +62,24 @@ void generateTasks(Board& board, uint8_t depth, const uint8_t goal_depth) {
 		return;
 	}
 
-	const size_t current_piece_index = board.getPieceIndex();
 	const uint64_t placements = board.placements();
+
+	// Cell-first tasks cover the first empty square, mirroring solveCellFirst()
+	if (cell_first) {
+		const uint8_t target = LSB(placements);
+		for (const AnchoredPlacement* p = cell_tables.begin(target); p != cell_tables.end(target); ++p) {
+			const int index = anchoredPiece(board, cell_tables, *p);
+			if (index < 0)
+				continue;
+
+			board.placePiece(index, p->pos);
+			generateTasks(board, depth + 1, goal_depth);
+			board.popPiece();
+		}
+		return;
+	}
+
+	const size_t current_piece_index = board.getPieceIndex();
 	const Tile t = board.getCurrentPiece();
 	const uint64_t piece = t.repr;
 	size_t start_pos = 0;
@@ -104,7 +127,10 @@ void threadManager(const std::vector<Tile>& tiles, const bool one_sol, const siz
 	else {
 		// Pre-generate tasks by expanding the first few levels of the tree
 		// If we only have 1 piece, depth 2 will cover it (depth 1 logic handles board.done())
-		generateTasks(board, 0, 3); // TODO: we can implement dynamic depth scaling
+		{
+			PerfScope scope(PHASE_TASKS);
+			generateTasks(board, 0, 3); // TODO: we can implement dynamic depth scaling
+		}
 		std::vector<std::thread> threads;
 		threads.reserve(num_threads);
 
@@ -120,11 +146,176 @@ void threadManager(const std::vector<Tile>& tiles, const bool one_sol, const siz
 			std::cout << "\nFound " << solution_count << (solution_count == 1 ? " solution." : " solutions.") << std::endl;
 	}
 }
+
+// Portfolio racing: several differently configured first-solution searches run in parallel and the first one to finish wins
+struct PortfolioEntry {
+	std::string name;
+	std::vector<Tile> tiles;
+	SearchConfig config;
+	uint32_t seed = 0; // Non-zero entries reshuffle the piece and value orders and restart with a growing node budget
+};
+
+struct PortfolioResult {
+	Board board;
+	size_t entry = 0;
+	size_t restarts = 0;
+	uint64_t nodes = 0;
+	bool found = false;
+};
+
+// Split an already sorted tile list into runs of identical tiles, so reorderings keep identical pieces adjacent
+std::vector<std::vector<Tile>> identicalGroups(const std::vector<Tile>& tiles) {
+	std::vector<std::vector<Tile>> groups;
+	for (const Tile& t : tiles) {
+		if (groups.empty() || !(groups.back().front() == t))
+			groups.emplace_back();
+		groups.back().push_back(t);
+	}
+	return groups;
+}
+
+std::vector<Tile> flattenGroups(const std::vector<std::vector<Tile>>& groups) {
+	std::vector<Tile> tiles;
+	for (const std::vector<Tile>& g : groups)
+		tiles.insert(tiles.end(), g.begin(), g.end());
+	return tiles;
+}
+
+// Shuffle identical-tile groups among groups of the same size, keeping the larger-first ordering intact
+std::vector<Tile> shuffledOrder(const std::vector<Tile>& tiles, std::mt19937& rng) {
+	std::vector<std::vector<Tile>> groups = identicalGroups(tiles);
+	for (size_t begin = 0; begin < groups.size();) {
+		size_t end = begin + 1;
+		const uint8_t size = BIT_COUNT(groups[begin].front().repr);
+		while (end < groups.size() && BIT_COUNT(groups[end].front().repr) == size)
+			++end;
+		std::shuffle(groups.begin() + begin, groups.begin() + end, rng);
+		begin = end;
+	}
+	return flattenGroups(groups);
+}
+
+// Add a configuration unless an earlier one would run exactly the same search
+void addPortfolioEntry(std::vector<PortfolioEntry>& entries, PortfolioEntry entry) {
+	for (const PortfolioEntry& e : entries)
+		if (e.tiles == entry.tiles && e.config.value_order == entry.config.value_order)
+			return;
+	entries.push_back(std::move(entry));
+}
+
+std::vector<PortfolioEntry> buildPortfolio(const std::vector<Tile>& tiles, const size_t count) {
+	// Most constrained order: larger tiles first, then tiles with the fewest placements on an empty board
+	std::vector<std::vector<Tile>> groups = identicalGroups(tiles);
+	std::stable_sort(groups.begin(), groups.end(), [](const std::vector<Tile>& a, const std::vector<Tile>& b) {
+		const uint8_t count_a = BIT_COUNT(a.front().repr);
+		const uint8_t count_b = BIT_COUNT(b.front().repr);
+		if (count_a != count_b)
+			return count_a > count_b;
+		return (8 - a.front().p_width) * (8 - a.front().p_height) < (8 - b.front().p_width) * (8 - b.front().p_height);
+	});
+	const std::vector<Tile> constrained = flattenGroups(groups);
+
+	SearchConfig forward;
+	SearchConfig reverse;
+	std::reverse(reverse.value_order.begin(), reverse.value_order.end());
+
+	std::vector<PortfolioEntry> entries;
+	addPortfolioEntry(entries, { "default order, forward values", tiles, forward, 0 });
+	addPortfolioEntry(entries, { "default order, reverse values", tiles, reverse, 0 });
+	addPortfolioEntry(entries, { "constrained order, forward values", constrained, forward, 0 });
+	addPortfolioEntry(entries, { "constrained order, reverse values", constrained, reverse, 0 });
+
+	// Anything beyond the fixed configurations is a randomised restart search, which draws its orders per restart
+	for (uint32_t seed = 1; entries.size() < count; ++seed)
+		entries.push_back({ "random restarts, seed " + std::to_string(seed), tiles, forward, seed });
+
+	if (entries.size() > count)
+		entries.resize(count);
+	return entries;
+}
+
+void portfolioThread(const PortfolioEntry& entry, const size_t index, PortfolioResult& result, std::mutex& result_lock) {
+	std::mt19937 rng(entry.seed);
+	SearchConfig config = entry.config;
+	config.cancel = &finished;
+
+	size_t restarts = 0;
+	uint64_t total_nodes = 0;
+	uint64_t budget = PORTFOLIO_FIRST_BUDGET;
+	std::vector<Tile> order = entry.tiles;
+
+	while (!finished) {
+		if (entry.seed) {
+			// Piece order only changes when a size class has several distinct tiles, the value order always does
+			order = shuffledOrder(entry.tiles, rng);
+			std::shuffle(config.value_order.begin(), config.value_order.end(), rng);
+			config.node_limit = budget;
+		}
+
+		Board board(order);
+		uint64_t nodes = 0;
+		PerfScope scope(PHASE_SOLVE);
+		const bool found = solveInterruptible(board, config, nodes);
+		total_nodes += nodes;
+
+		// A search that ran to completion without a solution proves there is none, so it also ends the race
+		const bool exhausted = !found && !finished && (!config.node_limit || nodes < config.node_limit);
+		if (found || exhausted) {
+			std::lock_guard<std::mutex> lock(result_lock);
+			if (!finished.exchange(true)) {
+				result.board = board;
+				result.entry = index;
+				result.restarts = restarts;
+				result.nodes = total_nodes;
+				result.found = found;
+			}
+			return;
+		}
+
+		if (!entry.seed)
+			return;
+
+		++restarts;
+		budget *= 2;
+	}
+}
+
+void portfolioManager(const std::vector<Tile>& tiles, const size_t num_threads) {
+	// One search per thread, defaulting to one per hardware thread when --threads wasn't given
+	const size_t count = num_threads ? num_threads : std::max(std::thread::hardware_concurrency(), 1U);
+	std::vector<PortfolioEntry> entries = buildPortfolio(tiles, count);
+	PortfolioResult result;
+	std::mutex result_lock;
+
+	finished = false;
+
+	std::vector<std::thread> threads;
+	threads.reserve(entries.size());
+	for (size_t i = 0; i < entries.size(); ++i)
+		threads.emplace_back(portfolioThread, std::cref(entries[i]), i, std::ref(result), std::ref(result_lock));
+
+	for (std::thread& t : threads)
+		t.join();
+
+	if (!result.found)
+		std::cout << "No solutions." << std::endl;
+	else if (!silent) {
+		PerfScope scope(PHASE_OUTPUT);
+		std::cout << result.board;
+	}
+
+	const PortfolioEntry& winner = entries[result.entry];
+	std::cerr << (result.found ? "Portfolio winner: #" : "Portfolio search exhausted by #") << result.entry << " (" << winner.name << ") after " << result.nodes << " nodes";
+	if (winner.seed)
+		std::cerr << " and " << result.restarts << (result.restarts == 1 ? " restart" : " restarts");
+	std::cerr << std::endl;
+}
 #endif
 
 inline void singleSolve(Board& board, const bool one_sol) {
 	size_t dummy_count = 0;
-	bool found_solution = solve(board, dummy_count, one_sol, silent);
+	PerfScope scope(PHASE_SOLVE);
+	bool found_solution = cell_first ? solveCellFirst(board, cell_tables, dummy_count, one_sol, silent) : solve(board, dummy_count, one_sol, silent);
 
 	if (!found_solution)
 		std::cout << "No solutions." << std::endl;
@@ -138,9 +329,9 @@ int main(int argc, char* argv[]) {
 
 	if (argc < 2) {
 #ifndef NOMULTIT
-		std::cerr << "Usage: " << argv[0] << " <tile file> [--all-solutions] [--threads <num_threads>] [--color] [--blocks] [--silent] [--flat] [--encode]" << std::endl;
+		std::cerr << "Usage: " << argv[0] << " <tile file> [--all-solutions] [--threads <num_threads>] [--portfolio] [--cell-first] [--perf] [--color] [--blocks] [--silent] [--flat] [--encode]" << std::endl;
 #else
-		std::cerr << "Usage: " << argv[0] << " <tile file> [--all-solutions] [--color] [--blocks] [--silent] [--flat] [--encode]" << std::endl;
+		std::cerr << "Usage: " << argv[0] << " <tile file> [--all-solutions] [--cell-first] [--perf] [--color] [--blocks] [--silent] [--flat] [--encode]" << std::endl;
 #endif
 		return 1;
 	}
@@ -149,6 +340,7 @@ int main(int argc, char* argv[]) {
 	std::string input_file = argv[1];
 	size_t threads = 0;
 	bool one_sol = true;
+	bool portfolio = false;
 
 	for (uint8_t i = 2; i < argc; ++i) {
 		std::string arg = argv[i];
@@ -164,6 +356,10 @@ int main(int argc, char* argv[]) {
 			Board::setUseFlatOutput(true);
 		else if (arg == "--encode")
 			Board::setUseEncodeOutput(true);
+		else if (arg == "--cell-first")
+			cell_first = true;
+		else if (arg == "--perf")
+			PerfCounters::setEnabled(true);
 #ifndef NOMULTIT
 		else if (arg == "--threads") {
 			if (i + 1 < argc)
@@ -172,7 +368,8 @@ int main(int argc, char* argv[]) {
 				std::cerr << "Error: --threads requires a number." << std::endl;
 				return 1;
 			}
-		}
+		} else if (arg == "--portfolio")
+			portfolio = true;
 #endif
 	}
 
@@ -181,6 +378,16 @@ int main(int argc, char* argv[]) {
 		Board::setUseBlockCharacters(false);
 	}
 
+	if (portfolio && !one_sol) {
+		std::cerr << "WARNING: --portfolio only applies to first-solution searches, ignoring it with --all-solutions." << std::endl;
+		portfolio = false;
+	}
+
+	if (portfolio && cell_first) {
+		std::cerr << "WARNING: --portfolio races configurations of the default search, ignoring --cell-first." << std::endl;
+		cell_first = false;
+	}
+
 	std::ifstream in(input_file);
 	if (!in.good()) {
 		std::cerr << "Error: Unable to open input file \"" << input_file << "\"." << std::endl;
@@ -224,6 +431,16 @@ int main(int argc, char* argv[]) {
 		return 1;
 	}
 
+	// The cell-first engine never leaves a square empty, so the tiles must cover the board exactly
+	size_t area = 0;
+	for (const Tile& t : tiles)
+		area += BIT_COUNT(t.repr);
+
+	if (cell_first && area != 64) {
+		std::cerr << "WARNING: --cell-first requires tiles covering all 64 squares, falling back to the default search." << std::endl;
+		cell_first = false;
+	}
+
 	// Sort tiles by most restrictive placement, and group identicals
 	std::sort(tiles.begin(), tiles.end(), [](Tile a, Tile b) {
 		uint8_t count_a = BIT_COUNT(a.repr);
@@ -235,13 +452,22 @@ int main(int argc, char* argv[]) {
 		return a.repr > b.repr;
 	});
 
+	if (cell_first)
+		cell_tables = CellTables(tiles);
+
 	// Start our solver
 #ifndef NOMULTIT
-	threadManager(tiles, one_sol, threads);
+	if (portfolio)
+		portfolioManager(tiles, threads);
+	else
+		threadManager(tiles, one_sol, threads);
 #else
 	Board board(tiles);
 	singleSolve(board, one_sol);
 #endif
 
+	if (PerfCounters::enabled)
+		PerfCounters::report();
+
 	return 0;
 }
@@ -0,0 +1,289 @@
+#include "perf_counters.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+bool PerfCounters::enabled = false;
+
+// Totals of every thread that has flushed its counters
+static std::mutex totals_lock;
+static uint64_t global_totals[PHASE_COUNT][EVENT_COUNT];
+static bool global_opened[EVENT_COUNT];
+static uint64_t global_time_enabled = 0;
+static uint64_t global_time_running = 0;
+static bool any_opened = false;
+static bool warned = false;
+
+static const char* PHASE_NAMES[PHASE_COUNT] = { "other", "task generation", "solve()", "hasSolvableRegions()", "solution output" };
+
+#ifdef __linux__
+static int openEvent(const uint32_t type, const uint64_t config, const int group_fd) {
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr.exclude_kernel = 1; // Also lets us run with perf_event_paranoid = 2
+	attr.exclude_hv = 1;
+
+	// pid 0, cpu -1: count the calling thread on any CPU
+	return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+#endif
+
+PerfCounters::PerfCounters() : flushed_time_enabled(0), flushed_time_running(0), phase(PHASE_NONE), open(false), user_rdpmc(false) {
+	std::memset(last, 0, sizeof(last));
+	std::memset(totals, 0, sizeof(totals));
+	for (uint8_t e = 0; e < EVENT_COUNT; ++e) {
+		fds[e] = -1;
+		pages[e] = nullptr;
+	}
+
+#ifdef __linux__
+	const uint64_t cache_read_miss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	fds[EVENT_CYCLES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+	if (fds[EVENT_CYCLES] >= 0) {
+		// Group everything under the cycle counter so one read() samples all of them
+		fds[EVENT_INSTRUCTIONS] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, fds[EVENT_CYCLES]);
+		fds[EVENT_BRANCH_MISSES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, fds[EVENT_CYCLES]);
+		fds[EVENT_L1D_MISSES] = openEvent(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | cache_read_miss, fds[EVENT_CYCLES]);
+		fds[EVENT_LLC_MISSES] = openEvent(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | cache_read_miss, fds[EVENT_CYCLES]);
+		open = true;
+
+#if defined(__x86_64__) || defined(__i386__)
+		// rdpmc needs every event's user page, and the kernel has to allow it for all of them
+		const long page_size = sysconf(_SC_PAGESIZE);
+		user_rdpmc = true;
+		for (uint8_t e = 0; e < EVENT_COUNT; ++e) {
+			if (fds[e] < 0)
+				continue;
+
+			void* page = mmap(nullptr, page_size, PROT_READ, MAP_SHARED, fds[e], 0);
+			if (page == MAP_FAILED) {
+				user_rdpmc = false;
+				continue;
+			}
+
+			pages[e] = page;
+			user_rdpmc &= static_cast<const perf_event_mmap_page*>(page)->cap_user_rdpmc;
+		}
+#endif
+		sample();
+	}
+#else
+	errno = ENOSYS;
+#endif
+
+	if (!open) {
+		const int error = errno;
+		std::lock_guard<std::mutex> lock(totals_lock);
+		if (!warned)
+			std::cerr << "WARNING: Hardware performance counters are unavailable (" << std::strerror(error) << "), --perf will not report counts." << std::endl;
+		warned = true;
+	}
+}
+
+PerfCounters::~PerfCounters() {
+	flush();
+
+#ifdef __linux__
+	const long page_size = sysconf(_SC_PAGESIZE);
+	for (uint8_t e = 0; e < EVENT_COUNT; ++e) {
+		if (pages[e])
+			munmap(pages[e], page_size);
+		if (fds[e] >= 0)
+			close(fds[e]);
+	}
+#endif
+}
+
+// Add this thread's totals to the process-wide ones
+void PerfCounters::flush() {
+	enter(PHASE_NONE);
+
+	// The group only counts while it is on the PMU. If it had to share it, scale the counts up the way perf stat does,
+	// and if it never got on at all, there is nothing to scale.
+	uint64_t values[EVENT_COUNT];
+	uint64_t time_enabled = 0;
+	uint64_t time_running = 0;
+	if (open && !readGroup(values, &time_enabled, &time_running))
+		time_enabled = time_running = 0;
+
+	const double scale = time_running && time_running < time_enabled ? static_cast<double>(time_enabled) / time_running : 1.0;
+
+	std::lock_guard<std::mutex> lock(totals_lock);
+	for (uint8_t p = 0; p < PHASE_COUNT; ++p)
+		for (uint8_t e = 0; e < EVENT_COUNT; ++e)
+			global_totals[p][e] += static_cast<uint64_t>(totals[p][e] * scale);
+
+	if (open) {
+		any_opened = true;
+		for (uint8_t e = 0; e < EVENT_COUNT; ++e)
+			global_opened[e] |= fds[e] >= 0;
+
+		// Times are cumulative since the group was opened, so only add what is new since the last flush
+		global_time_enabled += time_enabled - flushed_time_enabled;
+		global_time_running += time_running - flushed_time_running;
+		flushed_time_enabled = time_enabled;
+		flushed_time_running = time_running;
+	}
+
+	std::memset(totals, 0, sizeof(totals));
+}
+
+// Read every event from its user page with rdpmc, without a system call
+bool PerfCounters::readUserSpace(uint64_t* values) const {
+#if defined(__linux__) && (defined(__x86_64__) || defined(__i386__))
+	for (uint8_t e = 0; e < EVENT_COUNT; ++e) {
+		if (fds[e] < 0)
+			continue;
+
+		const volatile perf_event_mmap_page* page = static_cast<const volatile perf_event_mmap_page*>(pages[e]);
+		uint32_t seq;
+		uint64_t count;
+
+		// The kernel updates the page under a sequence lock, retry if it changed while we were reading
+		do {
+			seq = page->lock;
+			std::atomic_signal_fence(std::memory_order_seq_cst);
+
+			if (!page->cap_user_rdpmc)
+				return false;
+
+			const uint32_t index = page->index;
+			count = page->offset;
+			if (index) { // 0 means the event is not on the PMU right now, and the offset holds the whole count
+				const uint16_t width = page->pmc_width;
+				int64_t pmc = __builtin_ia32_rdpmc(index - 1);
+				pmc <<= 64 - width;
+				pmc >>= 64 - width;
+				count += pmc;
+			}
+
+			std::atomic_signal_fence(std::memory_order_seq_cst);
+		} while (page->lock != seq);
+
+		values[e] = count;
+	}
+	return true;
+#else
+	(void)values;
+	return false;
+#endif
+}
+
+// Read the whole group with one system call
+bool PerfCounters::readGroup(uint64_t* values, uint64_t* time_enabled, uint64_t* time_running) const {
+#ifdef __linux__
+	struct {
+		uint64_t nr;
+		uint64_t time_enabled;
+		uint64_t time_running;
+		uint64_t values[EVENT_COUNT];
+	} data;
+
+	if (read(fds[EVENT_CYCLES], &data, sizeof(data)) <= 0)
+		return false;
+
+	// Values come back in the order the members were opened, skipping any that failed
+	size_t v = 0;
+	for (uint8_t e = 0; e < EVENT_COUNT && v < data.nr; ++e)
+		if (fds[e] >= 0)
+			values[e] = data.values[v++];
+
+	if (time_enabled)
+		*time_enabled = data.time_enabled;
+	if (time_running)
+		*time_running = data.time_running;
+	return true;
+#else
+	(void)values;
+	(void)time_enabled;
+	(void)time_running;
+	return false;
+#endif
+}
+
+// Read the counters and charge the difference since the last sample to the current phase
+void PerfCounters::sample() {
+	uint64_t values[EVENT_COUNT];
+	if (!(user_rdpmc && readUserSpace(values)) && !readGroup(values, nullptr, nullptr))
+		return;
+
+	for (uint8_t e = 0; e < EVENT_COUNT; ++e) {
+		if (fds[e] < 0)
+			continue;
+
+		totals[phase][e] += values[e] - last[e];
+		last[e] = values[e];
+	}
+}
+
+PerfPhase PerfCounters::enter(const PerfPhase next) {
+	const PerfPhase previous = phase;
+	if (open && next != phase)
+		sample();
+
+	phase = next;
+	return previous;
+}
+
+PerfCounters& PerfCounters::local() {
+	thread_local PerfCounters counters;
+	return counters;
+}
+
+void PerfCounters::report() {
+	// The calling thread's counters are only flushed when it exits, so flush them now
+	local().flush();
+
+	std::lock_guard<std::mutex> lock(totals_lock);
+	if (!any_opened)
+		return;
+
+	if (!global_time_running) {
+		std::cerr << "\nPerformance counters were opened but never scheduled on the PMU (the NMI watchdog or another perf user may hold them)." << std::endl;
+		return;
+	}
+
+	std::cerr << "\nPerformance counters (user space, all threads):\n";
+	if (global_time_running < global_time_enabled)
+		std::cerr << "Note: the counter group was multiplexed and only counted " << std::fixed << std::setprecision(1)
+				  << 100.0 * global_time_running / global_time_enabled << "% of the time, counts are scaled up to compensate.\n";
+	std::cerr << std::left << std::setw(24) << "phase" << std::right << std::setw(16) << "cycles" << std::setw(16) << "instructions" << std::setw(8) << "IPC"
+			  << std::setw(14) << "br-miss/ki" << std::setw(14) << "L1D-miss/ki" << std::setw(14) << "LLC-miss/ki" << '\n';
+
+	for (uint8_t p = 0; p < PHASE_COUNT; ++p) {
+		const uint64_t* counts = global_totals[p];
+		if (!counts[EVENT_CYCLES])
+			continue;
+
+		std::cerr << std::left << std::setw(24) << PHASE_NAMES[p] << std::right << std::setw(16) << counts[EVENT_CYCLES];
+		if (global_opened[EVENT_INSTRUCTIONS])
+			std::cerr << std::setw(16) << counts[EVENT_INSTRUCTIONS] << std::setw(8) << std::fixed << std::setprecision(2)
+					  << static_cast<double>(counts[EVENT_INSTRUCTIONS]) / counts[EVENT_CYCLES];
+		else
+			std::cerr << std::setw(16) << "n/a" << std::setw(8) << "n/a";
+
+		// Miss rates are per thousand instructions
+		for (const PerfEvent e : { EVENT_BRANCH_MISSES, EVENT_L1D_MISSES, EVENT_LLC_MISSES }) {
+			if (global_opened[e] && counts[EVENT_INSTRUCTIONS])
+				std::cerr << std::setw(14) << std::fixed << std::setprecision(3) << 1000.0 * counts[e] / counts[EVENT_INSTRUCTIONS];
+			else
+				std::cerr << std::setw(14) << "n/a";
+		}
+		std::cerr << '\n';
+	}
+	std::cerr << std::flush;
+}
\ No newline at end of file
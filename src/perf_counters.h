@@ -0,0 +1,71 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+#include <cstddef>
+
+// Search phases that hardware counters are attributed to
+enum PerfPhase : uint8_t {
+	PHASE_NONE,
+	PHASE_TASKS,   // Task generation
+	PHASE_SOLVE,   // solve() recursion, excluding the phases below
+	PHASE_REGIONS, // hasSolvableRegions()
+	PHASE_OUTPUT,  // Solution output
+	PHASE_COUNT
+};
+
+enum PerfEvent : uint8_t {
+	EVENT_CYCLES,
+	EVENT_INSTRUCTIONS,
+	EVENT_BRANCH_MISSES,
+	EVENT_L1D_MISSES,
+	EVENT_LLC_MISSES,
+	EVENT_COUNT
+};
+
+// Per-thread Linux perf counter group (perf_event_open). Counts are read at every phase switch
+// and the difference is charged to the phase being left, so nested phases are excluded from their parent.
+// Phase switches read the counters in user space with rdpmc where the kernel allows it, so the
+// profiler doesn't enter the kernel (and disturb the caches and branch predictor) in the hot path.
+class PerfCounters {
+	int fds[EVENT_COUNT];
+	void* pages[EVENT_COUNT]; // mmap'd perf_event_mmap_page of each event, for rdpmc
+	uint64_t last[EVENT_COUNT];
+	uint64_t totals[PHASE_COUNT][EVENT_COUNT];
+	uint64_t flushed_time_enabled; // Group times already added to the process-wide ones
+	uint64_t flushed_time_running;
+	PerfPhase phase;
+	bool open;
+	bool user_rdpmc;
+
+	bool readUserSpace(uint64_t* values) const;
+	bool readGroup(uint64_t* values, uint64_t* time_enabled, uint64_t* time_running) const;
+	void sample();
+	void flush();
+
+public:
+	PerfCounters();
+	~PerfCounters();
+
+	// Switch the calling thread to a new phase and return the one it was in
+	PerfPhase enter(const PerfPhase next);
+
+	static bool enabled;
+	static void setEnabled(bool enable) { enabled = enable; }
+	static PerfCounters& local(); // The calling thread's counters, opened on first use
+	static void report();		  // Print per-phase IPC and miss rates of all threads that have finished
+};
+
+// Attribute everything inside a scope to a phase, when --perf is enabled
+class PerfScope {
+	PerfPhase previous;
+
+public:
+	PerfScope(const PerfPhase phase) : previous(PerfCounters::enabled ? PerfCounters::local().enter(phase) : PHASE_NONE) {}
+	~PerfScope() {
+		if (PerfCounters::enabled)
+			PerfCounters::local().enter(previous);
+	}
+};
+
+#endif // PERF_COUNTERS_H
\ No newline at end of file
@@ -9,6 +9,7 @@ class PushPopHistoryArray {
         uint64_t occ;
         uint8_t pos; // 0-63 board index of the placement
         int8_t balance_delta;
+        uint8_t piece; // Index of the placed piece
     };
     Placement history[64];
     size_t used;
@@ -19,10 +20,11 @@ public:
     const Placement& back() const { return history[used - 1]; }
 
     const Placement& operator[](const size_t index) const { return history[index]; }
-    inline void emplace(const uint64_t occ, const uint8_t pos, const int8_t balance_delta) { 
+    inline void emplace(const uint64_t occ, const uint8_t pos, const int8_t balance_delta, const uint8_t piece) { 
         history[used].occ = occ;
         history[used].pos = pos;
         history[used].balance_delta = balance_delta;
+        history[used].piece = piece;
         ++used;
     }
     void pop() { if (used > 0) --used; }
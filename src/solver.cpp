@@ -1,11 +1,33 @@
 #include "solver.h"
+#include "perf_counters.h"
 #include <cmath>
 #include <cstdlib>
 
-bool solve(Board& board, size_t& solution_count, const bool one_solution, const bool silent) {
+// Flood fill check, charged to its own phase when profiling.
+// Every engine picks Profile once at its entry point, so the default recursion carries no profiling checks.
+template <bool Profile, bool AnyOrder = false>
+static inline bool solvableRegions(const Board& board) {
+	if constexpr (Profile) {
+		PerfScope scope(PHASE_REGIONS);
+		return AnyOrder ? board.hasSolvableRegionsAnyOrder() : board.hasSolvableRegions();
+	}
+	return AnyOrder ? board.hasSolvableRegionsAnyOrder() : board.hasSolvableRegions();
+}
+
+template <bool Profile>
+static inline void printSolution(const Board& board) {
+	if constexpr (Profile) {
+		PerfScope scope(PHASE_OUTPUT);
+		std::cout << board;
+	} else
+		std::cout << board;
+}
+
+template <bool Profile>
+static bool search(Board& board, size_t& solution_count, const bool one_solution, const bool silent) {
 	if (board.done()) { // Solved
 		if (!silent)
-			std::cout << board;
+			printSolution<Profile>(board);
 		++solution_count;
 		return true;
 	}
@@ -20,7 +42,7 @@ bool solve(Board& board, size_t& solution_count, const bool one_solution, const
 
 	// Optimization: Only run HSR after a significant part of the board has been filled
 	const Tile t = board.getCurrentPiece();
-	if (board.openSquares() + t.p_height * t.p_width > 32 && !board.hasSolvableRegions())
+	if (board.openSquares() + t.p_height * t.p_width > 32 && !solvableRegions<Profile>(board))
 		return false;
 
 	const size_t current_piece_index = board.getPieceIndex();
@@ -59,7 +81,7 @@ bool solve(Board& board, size_t& solution_count, const bool one_solution, const
 				continue;
 
 			board.place(piece, i);
-			const bool this_result = solve(board, solution_count, one_solution, silent);
+			const bool this_result = search<Profile>(board, solution_count, one_solution, silent);
 
 			if (this_result) {
 				if (one_solution)
@@ -72,4 +94,155 @@ bool solve(Board& board, size_t& solution_count, const bool one_solution, const
 	}
 
 	return result;
+}
+
+bool solve(Board& board, size_t& solution_count, const bool one_solution, const bool silent) {
+	return PerfCounters::enabled ? search<true>(board, solution_count, one_solution, silent) : search<false>(board, solution_count, one_solution, silent);
+}
+
+// State of one interruptible run. Candidate positions are kept as bitmasks over their rank in the value order,
+// so a node walks exactly the positions solve() would try, in the configured order.
+// Cancellation lowers the limit to the current node count, so the recursion only compares two integers to know it has to unwind.
+struct InterruptibleRun {
+	std::array<uint8_t, 64> order;
+	std::vector<uint64_t> piece_ranks; // Ranks of the positions each piece fits at
+	uint64_t ranks_from[65];		   // Ranks of the positions at or after a board index
+	uint64_t octant_ranks;			   // Ranks of the positions in the canonical octant
+	const std::atomic<bool>* cancel;
+	uint64_t nodes;
+	uint64_t limit;
+};
+
+#define CANCEL_POLL_MASK 1023 // Poll the cancellation flag every 1024 nodes
+
+// First-solution variant of solve() for the portfolio racer, with a node budget, cancellation and a configurable value order.
+// Kept separate so the extra state never reaches the default engine's recursion.
+template <bool Profile>
+static bool searchInterruptible(Board& board, InterruptibleRun& run) {
+	if (++run.nodes >= run.limit)
+		return false;
+
+	if (!(run.nodes & CANCEL_POLL_MASK) && run.cancel && run.cancel->load(std::memory_order_relaxed)) {
+		run.limit = run.nodes;
+		return false;
+	}
+
+	if (board.done())
+		return true;
+
+	// Same parity and region pruning as solve()
+	if (std::abs(board.getCurrentImbalance()) > board.getSuffixMaxImbalance())
+		return false;
+
+	const Tile t = board.getCurrentPiece();
+	if (board.openSquares() + t.p_height * t.p_width > 32 && !solvableRegions<Profile>(board))
+		return false;
+
+	const size_t current_piece_index = board.getPieceIndex();
+	const size_t start_pos = (current_piece_index > 0 && board.getPiece(current_piece_index) == board.getPiece(current_piece_index - 1)) ? 
+					          board.getLastPlacementPos() + 1 : 0;
+
+	const uint64_t placements = board.placements();
+	const uint64_t piece = t.repr;
+
+	uint64_t candidates = run.piece_ranks[current_piece_index] & run.ranks_from[start_pos];
+	if (!board.symmetryBroken()) // Symmetry breaking for the first piece: restrict to canonical octant
+		candidates &= run.octant_ranks;
+
+	while (candidates) {
+		const uint8_t i = run.order[LSB(candidates)];
+		candidates &= candidates - 1;
+
+		const uint64_t placed_piece = piece << i;
+		if ((placed_piece & placements) != placed_piece)
+			continue;
+
+		board.place(piece, i);
+		if (searchInterruptible<Profile>(board, run))
+			return true;
+
+		board.pop();
+
+		if (run.nodes >= run.limit)
+			return false;
+	}
+
+	return false;
+}
+
+bool solveInterruptible(Board& board, const SearchConfig& config, uint64_t& nodes) {
+	InterruptibleRun run;
+	run.order = config.value_order;
+	run.cancel = config.cancel;
+	run.nodes = 0;
+	run.limit = config.node_limit ? config.node_limit : UINT64_MAX;
+
+	// Translate the per-position rules into rank masks once per run rather than filtering at every node
+	run.octant_ranks = 0;
+	std::fill(run.ranks_from, run.ranks_from + 65, 0ULL);
+	for (uint8_t r = 0; r < 64; ++r) {
+		const uint8_t i = run.order[r];
+		for (uint8_t from = 0; from <= i; ++from)
+			run.ranks_from[from] |= 1ULL << r;
+		if (i / 8 <= 3 && i % 8 <= 3 && i / 8 <= i % 8)
+			run.octant_ranks |= 1ULL << r;
+	}
+
+	run.piece_ranks.resize(board.numPieces());
+	for (size_t p = 0; p < board.numPieces(); ++p) {
+		const Tile t = board.getPiece(p);
+		run.piece_ranks[p] = 0;
+		for (uint8_t r = 0; r < 64; ++r)
+			if (run.order[r] % 8 <= 7 - t.p_width && run.order[r] / 8 <= 7 - t.p_height)
+				run.piece_ranks[p] |= 1ULL << r;
+	}
+
+	const bool found = PerfCounters::enabled ? searchInterruptible<true>(board, run) : searchInterruptible<false>(board, run);
+	nodes = run.nodes;
+	return found;
+}
+
+template <bool Profile>
+static bool searchCellFirst(Board& board, const CellTables& cells, size_t& solution_count, const bool one_solution, const bool silent) {
+	if (board.done()) { // Solved
+		if (!silent)
+			printSolution<Profile>(board);
+		++solution_count;
+		return true;
+	}
+
+	// Same parity and region pruning as solve(), over the unplaced pieces rather than a suffix
+	if (std::abs(board.getCurrentImbalance()) > board.getRemainingMaxImbalance())
+		return false;
+
+	if (board.openSquares() > 32 && !solvableRegions<Profile, true>(board))
+		return false;
+
+	// Every square before the first empty one is filled, so whichever piece covers it must do so with its own lowest square
+	const uint8_t target = LSB(board.placements());
+	bool result = false;
+
+	for (const AnchoredPlacement* p = cells.begin(target); p != cells.end(target); ++p) {
+		const int index = anchoredPiece(board, cells, *p);
+		if (index < 0)
+			continue;
+
+		board.placePiece(index, p->pos);
+		const bool this_result = searchCellFirst<Profile>(board, cells, solution_count, one_solution, silent);
+
+		if (this_result) {
+			if (one_solution)
+				return true;
+			result = true;
+		}
+
+		board.popPiece();
+	}
+
+	return result;
+}
+
+bool solveCellFirst(Board& board, const CellTables& cells, size_t& solution_count, const bool one_solution, const bool silent) {
+	return PerfCounters::enabled ? searchCellFirst<true>(board, cells, solution_count, one_solution, silent)
+								 : searchCellFirst<false>(board, cells, solution_count, one_solution, silent);
 }
\ No newline at end of file
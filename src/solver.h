@@ -1,9 +1,45 @@
 #ifndef SOLVER_H
 #define SOLVER_H
 
+#include <array>
+#include <atomic>
 #include <unordered_set>
 #include "board.h"
 
+// Knobs for a single interruptible search run (used by the portfolio racer)
+struct SearchConfig {
+	std::array<uint8_t, 64> value_order;	   // Order in which placement positions are tried
+	uint64_t node_limit = 0;				   // Give up after this many nodes (0 = unlimited)
+	const std::atomic<bool>* cancel = nullptr; // Cooperative cancellation flag, polled every 1024 nodes
+
+	SearchConfig() {
+		for (uint8_t i = 0; i < 64; ++i)
+			value_order[i] = i;
+	}
+};
+
 bool solve(Board& board, size_t& solution_count, const bool one_solution, const bool silent);
 
+// Stop at the first solution, leaving it on the board
+bool solveInterruptible(Board& board, const SearchConfig& config, uint64_t& nodes);
+
+// Which piece would take an anchored placement on this board, or -1 if its group can't go there.
+// Shared by solveCellFirst() and cell-first task generation so both branch the same way.
+inline int anchoredPiece(const Board& board, const CellTables& cells, const AnchoredPlacement& p) {
+	// Identical pieces are always used lowest index first, so swapping them is never considered a new solution
+	const uint64_t group = board.getRemaining() & cells.getGroupMask(p.group);
+	if (!group || (p.mask & board.placements()) != p.mask)
+		return -1;
+
+	// Symmetry breaking: the first piece is restricted to the canonical octant, as in solve()
+	const uint8_t index = LSB(group);
+	if (!index && (p.pos / 8 > 3 || p.pos % 8 > 3 || p.pos / 8 > p.pos % 8))
+		return -1;
+
+	return index;
+}
+
+// Alternative engine that always covers the first empty square with any unplaced piece
+bool solveCellFirst(Board& board, const CellTables& cells, size_t& solution_count, const bool one_solution, const bool silent);
+
 #endif // SOLVER_H
\ No newline at end of file